@@ -1,26 +1,424 @@
 #include <adios2.h>
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
+#include <stdio.h>
 #include <string.h>
 
+//
+// Optional payload compression
+//
+// : lz4, zstd - compressed by the benchmark itself on a separate thread, so that compression
+//               of step i+1 overlaps the transport of step i (and decompression on the reader
+//               side overlaps the transport of the next step). Build with -DUSE_LZ4 / -DUSE_ZSTD.
+// : blosc, bzip2 - ADIOS2 operators; the library compresses inline in Put/EndStep, so there
+//               is no overlap and compress/decompress times are included in the transport time.
+//               ADIOS2 does not expose the compressed size, so ratio and (de)compress rate are
+//               measured offline on the test payloads when built with -DUSE_BLOSC / -DUSE_BZIP2.
+//
+#ifdef USE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef USE_BLOSC
+#include <blosc.h>
+#endif
+#ifdef USE_BZIP2
+#include <bzlib.h>
+#endif
+
 #define DATA_TRANSPORT "WAN"
 
+#define PIPELINE_DEPTH 4    // number of compressed steps in flight (and of pipeline buffers)
+#define N_PAYLOADS     16   // distinct messages, sent round-robin
+#define OFFLINE_MIN_TIME 0.5 // seconds, minimum timed (de)compression for ADIOS2 operators
+
 using namespace std;
 using namespace std::chrono;
 
-int adios_writer(std::string path, unsigned long msz_size, unsigned long msz_count)
+enum Codec { CODEC_NONE, CODEC_LZ4, CODEC_ZSTD, CODEC_BLOSC, CODEC_BZIP2 };
+
+enum Payload { PAYLOAD_PATTERN, PAYLOAD_FIELD, PAYLOAD_TEXT, PAYLOAD_RANDOM };
+
+typedef struct _compress_stats {
+    double raw_size;        // Bytes
+    double comp_size;       // Bytes
+    double comp_time;       // seconds
+} compress_stats;
+
+// pipeline buffers are allocated once at full capacity and recycled; size is the valid length
+typedef struct _pipe_buffer {
+    std::vector<char> data;
+    size_t size;
+} pipe_buffer;
+
+//
+// Bounded queue between the transport loop and the (de)compression thread.
+// pop() returns false once the queue has been closed and drained.
+//
+template <typename T>
+class PipeQueue
+{
+public:
+    void push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_items.size() < PIPELINE_DEPTH; });
+        m_items.push_back(std::move(item));
+        m_not_empty.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_full, m_not_empty;
+    std::deque<T> m_items;
+    bool m_closed = false;
+};
+
+static void error(std::string msg)
+{
+    std::cerr << msg << std::endl;
+    exit(1);
+}
+
+static Codec parse_codec(std::string name)
+{
+    if (name == "none")
+        return CODEC_NONE;
+    if (name == "lz4") {
+#ifdef USE_LZ4
+        return CODEC_LZ4;
+#else
+        error("lz4 support was not compiled in (-DUSE_LZ4)");
+#endif
+    }
+    if (name == "zstd") {
+#ifdef USE_ZSTD
+        return CODEC_ZSTD;
+#else
+        error("zstd support was not compiled in (-DUSE_ZSTD)");
+#endif
+    }
+    if (name == "blosc")
+        return CODEC_BLOSC;
+    if (name == "bzip2")
+        return CODEC_BZIP2;
+    error("Unknown codec: " + name);
+    return CODEC_NONE;
+}
+
+static bool is_adios_operator(Codec codec)
+{
+    return codec == CODEC_BLOSC || codec == CODEC_BZIP2;
+}
+
+// whether compress()/decompress() can run the codec locally
+static bool is_linked(Codec codec)
+{
+    switch (codec)
+    {
+#ifdef USE_LZ4
+    case CODEC_LZ4:   return true;
+#endif
+#ifdef USE_ZSTD
+    case CODEC_ZSTD:  return true;
+#endif
+#ifdef USE_BLOSC
+    case CODEC_BLOSC: return true;
+#endif
+#ifdef USE_BZIP2
+    case CODEC_BZIP2: return true;
+#endif
+    default:          return false;
+    }
+}
+
+// bzip2 block size is 1..9 (x 100k); the same clamp is used for the ADIOS2 operator
+static int bzip2_level(int level)
+{
+    return std::max(1, std::min(level, 9));
+}
+
+//
+// Test payloads
+// : 0 pattern - the original j%255 ramp (trivially compressible)
+// : 1 field   - smooth float32 simulation field with a little noise
+// : 2 text    - log-like ASCII records
+// : 3 random  - incompressible bytes
+//
+static void make_payload(std::vector<char>& buf, unsigned long msz_size, unsigned long id, int type)
+{
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL * (id + 1);
+    auto next = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (unsigned int)(seed >> 33);
+    };
+
+    buf.resize(msz_size);
+    switch (type)
+    {
+    case PAYLOAD_FIELD: {
+        unsigned long n = msz_size / sizeof(float);
+        float *field = reinterpret_cast<float*>(buf.data());
+        for (unsigned long k = 0; k < n; k++) {
+            double x = double(k) / 256.0 + 0.1 * double(id);
+            double noise = double(next() % 1000) / 1000.0 - 0.5;
+            // quantize to 1e-3, as a typical analysis output would
+            field[k] = float(std::round((300.0 + 20.0 * sin(x) + 5.0 * cos(7.0 * x) + 0.01 * noise) * 1000.0) / 1000.0);
+        }
+        for (unsigned long j = n * sizeof(float); j < msz_size; j++)
+            buf[j] = 0;
+        break;
+    }
+    case PAYLOAD_TEXT: {
+        static const char *vars[] = {"temperature", "pressure", "density", "velocity_x", "velocity_y"};
+        std::string text;
+        char line[128];
+        while (text.size() < msz_size) {
+            snprintf(line, sizeof(line), "step=%lu rank=%u var=%s value=%.4f status=OK\n",
+                     id, next() % 64, vars[next() % 5], double(next() % 100000) / 100.0);
+            text += line;
+        }
+        memcpy(buf.data(), text.data(), msz_size);
+        break;
+    }
+    case PAYLOAD_RANDOM:
+        for (unsigned long j = 0; j < msz_size; j++)
+            buf[j] = char(next() & 0xff);
+        break;
+    default:
+        for (unsigned long j = 0; j < msz_size; j++)
+            buf[j] = char(j%255);
+        break;
+    }
+}
+
+static size_t compress_bound(Codec codec, size_t n)
+{
+    switch (codec)
+    {
+#ifdef USE_LZ4
+    case CODEC_LZ4:  return LZ4_compressBound(n);
+#endif
+#ifdef USE_ZSTD
+    case CODEC_ZSTD: return ZSTD_compressBound(n);
+#endif
+#ifdef USE_BLOSC
+    case CODEC_BLOSC: return n + BLOSC_MAX_OVERHEAD;
+#endif
+#ifdef USE_BZIP2
+    case CODEC_BZIP2: return n + n / 100 + 600;
+#endif
+    default:         return n;
+    }
+}
+
+static size_t compress(Codec codec, int level, const char *src, size_t n, char *dst, size_t cap)
+{
+    switch (codec)
+    {
+#ifdef USE_LZ4
+    case CODEC_LZ4: {
+        // level <= 1: fast mode; higher levels use LZ4HC
+        int sz = level <= 1 ? LZ4_compress_default(src, dst, n, cap)
+                            : LZ4_compress_HC(src, dst, n, cap, level);
+        if (sz <= 0)
+            error("LZ4 compression failed");
+        return sz;
+    }
+#endif
+#ifdef USE_ZSTD
+    case CODEC_ZSTD: {
+        size_t sz = ZSTD_compress(dst, cap, src, n, level);
+        if (ZSTD_isError(sz))
+            error(std::string("ZSTD compression failed: ") + ZSTD_getErrorName(sz));
+        return sz;
+    }
+#endif
+#ifdef USE_BLOSC
+    case CODEC_BLOSC: {
+        int sz = blosc_compress(level, BLOSC_SHUFFLE, sizeof(char), n, src, dst, cap);
+        if (sz <= 0)
+            error("Blosc compression failed");
+        return sz;
+    }
+#endif
+#ifdef USE_BZIP2
+    case CODEC_BZIP2: {
+        unsigned int sz = cap;
+        if (BZ2_bzBuffToBuffCompress(dst, &sz, const_cast<char*>(src), n, bzip2_level(level), 0, 0) != BZ_OK)
+            error("BZIP2 compression failed");
+        return sz;
+    }
+#endif
+    default:
+        (void)level; (void)cap;
+        memcpy(dst, src, n);
+        return n;
+    }
+}
+
+static size_t decompress(Codec codec, const char *src, size_t n, char *dst, size_t cap)
+{
+    switch (codec)
+    {
+#ifdef USE_LZ4
+    case CODEC_LZ4: {
+        int sz = LZ4_decompress_safe(src, dst, n, cap);
+        if (sz < 0)
+            error("LZ4 decompression failed");
+        return sz;
+    }
+#endif
+#ifdef USE_ZSTD
+    case CODEC_ZSTD: {
+        size_t sz = ZSTD_decompress(dst, cap, src, n);
+        if (ZSTD_isError(sz))
+            error(std::string("ZSTD decompression failed: ") + ZSTD_getErrorName(sz));
+        return sz;
+    }
+#endif
+#ifdef USE_BLOSC
+    case CODEC_BLOSC: {
+        (void)n;
+        int sz = blosc_decompress(src, dst, cap);
+        if (sz < 0)
+            error("Blosc decompression failed");
+        return sz;
+    }
+#endif
+#ifdef USE_BZIP2
+    case CODEC_BZIP2: {
+        unsigned int sz = cap;
+        if (BZ2_bzBuffToBuffDecompress(dst, &sz, const_cast<char*>(src), n, 0, 0) != BZ_OK)
+            error("BZIP2 decompression failed");
+        return sz;
+    }
+#endif
+    default:
+        memcpy(dst, src, std::min(n, cap));
+        return std::min(n, cap);
+    }
+}
+
+//
+// Offline measurement for ADIOS2 operators: (de)compress the test payloads with the same
+// codec and level. One untimed warm-up pass absorbs first-call and workspace setup, then
+// whole passes are repeated until OFFLINE_MIN_TIME, so that the rates are comparable to
+// the lz4/zstd ones measured over the run. comp measures compression, decomp decompression.
+//
+static void measure_offline(Codec codec, int level, const std::vector<std::vector<char>>& payloads,
+                            compress_stats *comp, compress_stats *decomp)
+{
+    size_t n_payloads = payloads.size();
+    std::vector<std::vector<char>> packed(n_payloads), unpacked(n_payloads);
+    std::vector<size_t> packed_size(n_payloads);
+    double raw_size = 0.0, comp_size = 0.0;
+
+    // warm-up
+    for (size_t k = 0; k < n_payloads; k++) {
+        packed[k].resize(compress_bound(codec, payloads[k].size()));
+        unpacked[k].resize(payloads[k].size());
+        packed_size[k] = compress(codec, level, payloads[k].data(), payloads[k].size(),
+                                  packed[k].data(), packed[k].size());
+        decompress(codec, packed[k].data(), packed_size[k], unpacked[k].data(), unpacked[k].size());
+        raw_size += double(payloads[k].size());
+        comp_size += double(packed_size[k]);
+    }
+
+    auto timed = [&](compress_stats *stats, bool bCompress) {
+        high_resolution_clock::time_point c1 = high_resolution_clock::now();
+        do {
+            for (size_t k = 0; k < n_payloads; k++) {
+                if (bCompress)
+                    compress(codec, level, payloads[k].data(), payloads[k].size(), packed[k].data(), packed[k].size());
+                else
+                    decompress(codec, packed[k].data(), packed_size[k], unpacked[k].data(), unpacked[k].size());
+            }
+            stats->raw_size += raw_size;
+            stats->comp_size += comp_size;
+            stats->comp_time = (double)duration_cast<nanoseconds>(high_resolution_clock::now() - c1).count() / 1e9;
+        } while (stats->comp_time < OFFLINE_MIN_TIME);
+    };
+    timed(comp, true);
+    timed(decomp, false);
+}
+
+//
+// stats gives the ratio and (de)compress rate, raw_size the uncompressed Bytes moved in
+// duration seconds. For ADIOS2 operators stats comes from measure_offline(), and is
+// empty if the codec is not linked locally.
+//
+static void print_compress_stats(const char *who, std::string codec, const compress_stats& stats,
+                                 double raw_size, double duration, bool bOffline)
+{
+    double raw_mb = raw_size / 1024.0 / 1024.0;
+    std::cout << "[ADIOS " << who << " COMPRESSION]\n"
+              << "Codec            : " << codec << (bOffline ? " (ADIOS2 operator)" : "") << "\n"
+              << "Raw size         : " << raw_mb << " MBytes\n";
+    if (stats.comp_size > 0.0)
+    {
+        double ratio = stats.raw_size / stats.comp_size;
+        std::cout << (bOffline ? "Est. compressed  : " : "Compressed size  : ") << raw_mb / ratio << " MBytes\n"
+                  << "Ratio            : " << ratio << (bOffline ? " (offline)" : "") << "\n"
+                  << (who[0] == 'W' ? "Compress rate    : " : "Decompress rate  : ")
+                  << stats.raw_size / 1024.0 / 1024.0 / stats.comp_time << " MBytes/sec"
+                  << (bOffline ? " (offline)" : "") << "\n"
+                  << "Wire throughput  : " << raw_mb / ratio / duration << " MBytes/sec\n";
+    }
+    else
+    {
+        std::cout << "Ratio            : unavailable for ADIOS operators (build with -DUSE_BLOSC / -DUSE_BZIP2)\n";
+    }
+    std::cout << "Effective bw     : " << raw_mb / duration << " MBytes/sec\n"
+              << std::endl;
+}
+
+int adios_writer(std::string path, unsigned long msz_size, unsigned long msz_count,
+                 std::string codec_name, int level, int payload)
 {
     adios2::ADIOS ad;
     adios2::IO io;
     adios2::Engine writer;
     adios2::Variable<char> data;
-    std::vector<char> test_data;
+    std::vector<std::vector<char>> test_data(N_PAYLOADS);
     high_resolution_clock::time_point t1, t2;
     double duration, total_size;
     unsigned long i;
+    Codec codec = parse_codec(codec_name);
+    bool bPipelined = codec == CODEC_LZ4 || codec == CODEC_ZSTD;
+    compress_stats stats = {0.0, 0.0, 0.0}, unused = {0.0, 0.0, 0.0};
+    PipeQueue<pipe_buffer> queue, free_buffers;
+    std::thread compressor;
 
     // initialize adios
     ad = adios2::ADIOS(MPI_COMM_SELF, true);
@@ -30,28 +428,70 @@ int adios_writer(std::string path, unsigned long msz_size, unsigned long msz_cou
     //io.SetParameters({{"RendezvousReaderCount", "1"}});
 
     data = io.DefineVariable<char>("data", {msz_size}, {0}, {msz_size}, false);
-    test_data.resize(msz_size*msz_count);
-    for (i = 0; i < msz_size*msz_count; i++) {
-        unsigned long num = i%msz_size;
-        test_data[i] = char(num%255);
+    if (is_adios_operator(codec))
+    {
+        adios2::Operator op = ad.DefineOperator("compressor", codec_name);
+        if (codec == CODEC_BLOSC)
+            data.AddOperation(op, {{"clevel", std::to_string(level)}});
+        else
+            data.AddOperation(op, {{"blockSize100k", std::to_string(bzip2_level(level))}});
     }
-    //std::fill(test_data.begin(), test_data.end(), 0);
+    for (i = 0; i < N_PAYLOADS; i++)
+        make_payload(test_data[i], msz_size, i, payload);
+    if (is_adios_operator(codec) && is_linked(codec))
+        measure_offline(codec, level, test_data, &stats, &unused);
+    if (bPipelined)
+        for (i = 0; i < PIPELINE_DEPTH; i++)
+            free_buffers.push(pipe_buffer{std::vector<char>(compress_bound(codec, msz_size)), 0});
 
     writer = io.Open(path, adios2::Mode::Write);
 
-    std::cout << "[ADIOS] Start writing: " << msz_size << ", " << msz_count << std::endl;
-    
+    std::cout << "[ADIOS] Start writing: " << msz_size << ", " << msz_count
+              << " (" << codec_name << ", level " << level << ")" << std::endl;
+
     // Promise that no more definitions or changes to defined variables will occur.
-    // Useful information if called before the first EndStep() of an output Engine. 
+    // Useful information if called before the first EndStep() of an output Engine.
     //writer.LockWriterDefinitions();
 
     t1 = high_resolution_clock::now();
-    for (i = 0; i < msz_count; i++)
+    if (bPipelined)
     {
-        writer.BeginStep(adios2::StepMode::Update);
-        writer.Put(data, test_data.data());
-        writer.EndStep();
-        //std::cout << "Wrote " << i << "-th data!" << std::endl;
+        // compression stage: runs ahead of the transport by up to PIPELINE_DEPTH steps
+        compressor = std::thread([&]() {
+            pipe_buffer dst;
+            for (unsigned long k = 0; k < msz_count && free_buffers.pop(dst); k++) {
+                const std::vector<char>& src = test_data[k % N_PAYLOADS];
+                high_resolution_clock::time_point c1 = high_resolution_clock::now();
+                dst.size = compress(codec, level, src.data(), msz_size, dst.data.data(), dst.data.size());
+                high_resolution_clock::time_point c2 = high_resolution_clock::now();
+                stats.comp_time += (double)duration_cast<nanoseconds>(c2 - c1).count() / 1e9;
+                queue.push(std::move(dst));
+            }
+            queue.close();
+        });
+
+        pipe_buffer buf;
+        for (i = 0; queue.pop(buf); i++)
+        {
+            writer.BeginStep(adios2::StepMode::Update);
+            data.SetShape({buf.size});
+            data.SetSelection({{0}, {buf.size}});
+            writer.Put(data, buf.data.data());
+            writer.EndStep();
+            stats.comp_size += double(buf.size);
+            free_buffers.push(std::move(buf));
+        }
+        compressor.join();
+    }
+    else
+    {
+        for (i = 0; i < msz_count; i++)
+        {
+            writer.BeginStep(adios2::StepMode::Update);
+            writer.Put(data, test_data[i % N_PAYLOADS].data());
+            writer.EndStep();
+            //std::cout << "Wrote " << i << "-th data!" << std::endl;
+        }
     }
     t2 = high_resolution_clock::now();
     std::cout << "[ADIOS] End writing: " << i << std::endl;
@@ -60,19 +500,24 @@ int adios_writer(std::string path, unsigned long msz_size, unsigned long msz_cou
     {
         total_size = double(msz_count) * double(msz_size) / 1024.0 / 1024.0; // MBytes
         duration = (double)duration_cast<milliseconds>(t2 - t1).count() / 1000.0; // sec
-        std::cout << "[ADIOS WRITER]\n" 
+        std::cout << "[ADIOS WRITER]\n"
                   << "Total # messages : " << msz_count << "\n"
                   << "Message size     : " << msz_size << " Bytes\n"
                   << "Total size       : " << total_size << " MBytes\n"
                   << "Total time       : " << duration << " seconds\n"
                   << "Throughput       : " << total_size / duration << " MBytes/sec\n"
-                  << std::endl; 
+                  << std::endl;
     }
+    if (bPipelined)
+        stats.raw_size = double(i) * double(msz_size);
+    if (codec != CODEC_NONE)
+        print_compress_stats("WRITER", codec_name, stats, double(i) * double(msz_size), duration, !bPipelined);
 
     return 0;
 }
 
-int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_count, bool bCheck)
+int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_count, bool bCheck,
+                 std::string codec_name, int level, int payload)
 {
     adios2::ADIOS ad;
     adios2::IO io;
@@ -81,8 +526,15 @@ int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_cou
     unsigned long step;
     adios2::Variable<char> data;
     std::vector<char> test_data;
+    std::vector<std::vector<char>> expected(N_PAYLOADS);
     high_resolution_clock::time_point t1, t2;
     double duration, total_size;
+    Codec codec = parse_codec(codec_name);
+    bool bPipelined = codec == CODEC_LZ4 || codec == CODEC_ZSTD;
+    compress_stats stats = {0.0, 0.0, 0.0}, unused = {0.0, 0.0, 0.0};
+    PipeQueue<pipe_buffer> queue, free_buffers;
+    pipe_buffer buf;
+    std::thread decompressor;
 
     // initialize adios
     ad = adios2::ADIOS(MPI_COMM_SELF, true);
@@ -93,6 +545,35 @@ int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_cou
 
     step = 0;
     test_data.resize(msz_size);
+    if (bCheck || (is_adios_operator(codec) && is_linked(codec)))
+        for (unsigned long k = 0; k < N_PAYLOADS; k++)
+            make_payload(expected[k], msz_size, k, payload);
+    if (is_adios_operator(codec) && is_linked(codec))
+        measure_offline(codec, level, expected, &unused, &stats);
+
+    // decompression stage: works on step i while the transport fetches step i+1
+    if (bPipelined)
+    {
+        for (unsigned long k = 0; k < PIPELINE_DEPTH; k++)
+            free_buffers.push(pipe_buffer{std::vector<char>(compress_bound(codec, msz_size)), 0});
+
+        decompressor = std::thread([&]() {
+            pipe_buffer src;
+            std::vector<char> dst(msz_size);
+            for (unsigned long k = 0; queue.pop(src); k++) {
+                high_resolution_clock::time_point c1 = high_resolution_clock::now();
+                size_t n = decompress(codec, src.data.data(), src.size, dst.data(), dst.size());
+                high_resolution_clock::time_point c2 = high_resolution_clock::now();
+                stats.comp_time += (double)duration_cast<nanoseconds>(c2 - c1).count() / 1e9;
+                stats.comp_size += double(src.size);
+                stats.raw_size += double(n);
+                free_buffers.push(std::move(src));
+
+                if (bCheck && (n != msz_size || memcmp(dst.data(), expected[k % N_PAYLOADS].data(), msz_size) != 0))
+                    std::cout << "Incorrect data at step " << k << std::endl;
+            }
+        });
+    }
 
     std::cout << "[ADIOS] Start reading ..." << std::endl;
     //t1 = high_resolution_clock::now();
@@ -118,7 +599,17 @@ int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_cou
         }
 
         data = io.InquireVariable<char>("data");
-        if (data)
+        if (data && bPipelined)
+        {
+            // compressed steps differ in size; the shape carries the compressed length
+            free_buffers.pop(buf);
+            buf.size = data.Shape()[0];
+            if (buf.size > buf.data.size())
+                buf.data.resize(buf.size);
+            data.SetSelection({{0}, {buf.size}});
+            reader.Get<char>(data, buf.data.data());
+        }
+        else if (data)
         {
             data.SetSelection({{0}, {msz_size}});
             //reader.Get<char>(data, test_data.data(), adios2::Mode::Sync);
@@ -131,18 +622,28 @@ int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_cou
         }
         reader.EndStep();
 
-        if (bCheck && data)
+        if (bPipelined && data)
+        {
+            queue.push(std::move(buf));
+        }
+        else if (bCheck && data)
         {
+            const std::vector<char>& ref = expected[step % N_PAYLOADS];
             for (size_t i = 0; i < test_data.size(); i++)
-                if (test_data[i] != char(i%255))
+                if (test_data[i] != ref[i])
                 {
-                    std::cout << "Incorrect data: " << test_data[i] << " vs. " << char(i%255) << std::endl;
+                    std::cout << "Incorrect data: " << test_data[i] << " vs. " << ref[i] << std::endl;
                     break;
                 }
         }
 
         step++;
     }
+    if (bPipelined)
+    {
+        queue.close();
+        decompressor.join();
+    }
     t2 = high_resolution_clock::now();
     std::cout << "[ADIOS] End reading: " << step << std::endl;
     reader.Close();
@@ -150,14 +651,16 @@ int adios_reader(std::string path, unsigned long msz_size, unsigned long msz_cou
     {
         total_size = double(step) * double(msz_size) / 1024.0 / 1024.0; // MBytes
         duration = (double)duration_cast<milliseconds>(t2 - t1).count() / 1000.0; // sec
-        std::cout << "[ADIOS READER]\n" 
+        std::cout << "[ADIOS READER]\n"
                   << "Total # messages : " << step << "\n"
                   << "Message size     : " << msz_size << " Bytes\n"
                   << "Total size       : " << total_size << " MBytes\n"
                   << "Total time       : " << duration << " seconds\n"
                   << "Throughput       : " << total_size / duration << " MBytes/sec\n"
-                  << std::endl;         
+                  << std::endl;
     }
+    if (codec != CODEC_NONE)
+        print_compress_stats("READER", codec_name, stats, double(step) * double(msz_size), duration, !bPipelined);
 
     return 0;
 }
@@ -171,15 +674,18 @@ int main(int argc, char** argv)
     MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
     MPI_Comm_size(MPI_COMM_WORLD, &wsize);
 
-    int role = atoi(argv[1]); 
+    int role = atoi(argv[1]);
     unsigned long msz_size = (unsigned long)atoi(argv[2]);
     unsigned long msz_count = (unsigned long)atoi(argv[3]);
     int check = atoi(argv[4]);
- 
+    std::string codec = argc > 5 ? argv[5] : "none";
+    int level = argc > 6 ? atoi(argv[6]) : 1;
+    int payload = argc > 7 ? atoi(argv[7]) : PAYLOAD_PATTERN;
+
     if (role == 0)
-        adios_reader("test.bp", msz_size, msz_count, check==1);
+        adios_reader("test.bp", msz_size, msz_count, check==1, codec, level, payload);
     else
-        adios_writer("test.bp", msz_size, msz_count);
+        adios_writer("test.bp", msz_size, msz_count, codec, level, payload);
 
     MPI_Finalize();
     return 0;
@@ -0,0 +1,582 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <time.h>
+//
+// Persistent shared-memory queue
+//
+// Unlike main_shm.cpp, all of the queue state lives inside the shared segment, so
+// either side can die and be restarted without reinitializing the queue:
+//
+// : header  - magic, layout version and slot geometry. An attaching process validates
+//             them and refuses to use a segment that was created with a different layout.
+// : init    - state 0 (empty), 1 (initializing), 2 (ready) packed with the pid of the
+//             initializer into one 64-bit word, so that claiming the initialization is a
+//             single CAS. Whoever creates the segment first initializes it; the other side
+//             waits until it becomes ready. If the initializer dies half-way, the next
+//             process to attach takes over.
+// : cursors - head (next sequence number to be written) and tail (next sequence number
+//             to be read). They are absolute 64-bit counters and are only advanced
+//             after a slot has been completely written/read ("committed"), so a process
+//             that crashes in the middle of a copy simply redoes that slot on restart.
+//             Delivery is at-least-once: a reader killed between the copy and the
+//             commit sees the same message again.
+// : owners  - pid and generation of the current writer/reader. The generation is
+//             bumped on every attach, so a restarted process can tell how many times
+//             its role has been recycled.
+//
+// There is a single producer and a single consumer, so no lock is needed: the cursors
+// are atomics and blocking is done with process-shared futexes on 32-bit sequence
+// words. Nothing is ever "held", so a process dying at any point cannot leave the
+// other side blocked on a lock. While waiting, the peer's owner pid is checked: a live
+// peer is waited for indefinitely (it may just be slow), a dead one is reported right
+// away, and a vacant role is only waited for up to a configurable timeout.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <mpi.h>
+
+using namespace std;
+using namespace std::chrono;
+
+#define MAX_BUFFERS 10
+
+#define SHARED_MEM_NAME "/mypersistent-mem"
+
+#define PSHM_MAGIC   0x5053484dU    // "PSHM"
+#define PSHM_VERSION 2
+
+#define STATE_EMPTY        0
+#define STATE_INITIALIZING 1
+#define STATE_READY        2
+
+#define WAIT_TIMEOUT_MS   100       // futex wait granularity, i.e. how often the peer is checked
+#define VACANT_TIMEOUT_MS 30000     // default: give up if no peer is attached for this long
+
+#define CACHE_LINE 64
+
+typedef struct _pshm_header {
+    // layout (written once by the initializer)
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t n_slots;
+    std::atomic<uint64_t> init;             // (pid << 32) | state
+
+    // writer side
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> head_seq;         // futex word, bumped on every commit of head
+    std::atomic<uint32_t> writer_waiting;
+    std::atomic<pid_t>    writer_pid;
+    std::atomic<uint32_t> writer_gen;
+
+    // reader side
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> tail_seq;         // futex word, bumped on every commit of tail
+    std::atomic<uint32_t> reader_waiting;
+    std::atomic<pid_t>    reader_pid;
+    std::atomic<uint32_t> reader_gen;
+} pshm_header;
+
+typedef struct _pshm_slot {
+    uint64_t seq;
+    uint32_t size;
+    char     data[];
+} pshm_slot;
+
+typedef struct _latency_stats {
+    int    n;
+    double sum, min, max;   // usec
+} latency_stats;
+
+typedef struct _pshm_queue {
+    int          timeout_ms;    // how long to wait for a vacant role, < 0 waits forever
+    int          fd;
+    size_t       map_size;
+    size_t       slot_stride;
+    pshm_header *hdr;
+    char        *slots;
+} pshm_queue;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "futex words must be lock-free");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "cursors must be lock-free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be 32-bit");
+
+void error(std::string msg);
+
+static int futex_wait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    // no FUTEX_PRIVATE_FLAG: the word is shared between processes
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static int futex_wake(std::atomic<uint32_t> *addr)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static bool pid_alive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static uint64_t init_word(pid_t pid, uint32_t state)
+{
+    return ((uint64_t)(uint32_t)pid << 32) | state;
+}
+
+static size_t slot_stride(int msz_size)
+{
+    size_t sz = sizeof(pshm_slot) + msz_size;
+    return (sz + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+static pshm_slot *get_slot(pshm_queue *q, uint64_t seq)
+{
+    return (pshm_slot*)(q->slots + (seq % q->hdr->n_slots) * q->slot_stride);
+}
+
+//
+// Attach to the queue, creating and initializing it if necessary.
+// Either side may call this first, and either side may call it again after a crash.
+//
+static void pshm_attach(pshm_queue *q, int msz_size, bool bWriter)
+{
+    pshm_header *hdr;
+    struct stat st;
+
+    q->slot_stride = slot_stride(msz_size);
+    q->map_size = sizeof(pshm_header) + MAX_BUFFERS * q->slot_stride;
+
+    if ((q->fd = shm_open(SHARED_MEM_NAME, O_RDWR | O_CREAT, 0660)) == -1)
+        error("shm_open");
+
+    // only grow a fresh object; never shrink a segment the peer has already mapped
+    if (fstat(q->fd, &st) == -1)
+        error("fstat");
+    if (st.st_size == 0 && ftruncate(q->fd, q->map_size) == -1)
+        error("ftruncate");
+    else if (st.st_size != 0 && (size_t)st.st_size != q->map_size) {
+        std::cerr << "[PSHM] Segment size mismatch: " << st.st_size << " vs. " << q->map_size
+                  << " Bytes (different message size?)" << std::endl;
+        exit(1);
+    }
+
+    if ((q->hdr = (pshm_header*)mmap(NULL, q->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0)) == MAP_FAILED)
+        error("mmap");
+    hdr = q->hdr;
+    q->slots = (char*)q->hdr + sizeof(pshm_header);
+
+    // one-time initialization; a fresh object is zero-filled, i.e. STATE_EMPTY
+    int waited_us = 0;
+    for (;;) {
+        uint64_t word = hdr->init.load(std::memory_order_acquire);
+        uint32_t state = (uint32_t)word;
+        pid_t owner = (pid_t)(word >> 32);
+        if (state == STATE_READY)
+            break;
+
+        // state and owner are claimed together, so only one process can win
+        if (state == STATE_EMPTY || (state == STATE_INITIALIZING && !pid_alive(owner))) {
+            if (!hdr->init.compare_exchange_strong(word, init_word(getpid(), STATE_INITIALIZING)))
+                continue;
+
+            hdr->magic = PSHM_MAGIC;
+            hdr->version = PSHM_VERSION;
+            hdr->slot_size = msz_size;
+            hdr->n_slots = MAX_BUFFERS;
+            hdr->head.store(0);
+            hdr->head_seq.store(0);
+            hdr->writer_waiting.store(0);
+            hdr->writer_pid.store(0);
+            hdr->writer_gen.store(0);
+            hdr->tail.store(0);
+            hdr->tail_seq.store(0);
+            hdr->reader_waiting.store(0);
+            hdr->reader_pid.store(0);
+            hdr->reader_gen.store(0);
+
+            hdr->init.store(init_word(getpid(), STATE_READY), std::memory_order_release);
+            break;
+        }
+        if (q->timeout_ms >= 0 && waited_us >= q->timeout_ms * 1000) {
+            std::cerr << "[PSHM] Segment is still being initialized by pid " << owner
+                      << " after " << q->timeout_ms << " ms" << std::endl;
+            exit(1);
+        }
+        usleep(100);
+        waited_us += 100;
+    }
+
+    if (hdr->magic != PSHM_MAGIC || hdr->version != PSHM_VERSION) {
+        std::cerr << "[PSHM] Incompatible segment (magic " << std::hex << hdr->magic << std::dec
+                  << ", version " << hdr->version << ")" << std::endl;
+        exit(1);
+    }
+    if (hdr->slot_size != (uint32_t)msz_size || hdr->n_slots != MAX_BUFFERS) {
+        std::cerr << "[PSHM] Layout mismatch: " << hdr->n_slots << " x " << hdr->slot_size
+                  << " Bytes" << std::endl;
+        exit(1);
+    }
+
+    // claim the role; a previous owner is only replaced if it is no longer running
+    std::atomic<pid_t> &owner = bWriter ? hdr->writer_pid : hdr->reader_pid;
+    pid_t prev = owner.load();
+    do {
+        if (prev != 0 && prev != getpid() && pid_alive(prev)) {
+            std::cerr << "[PSHM] " << (bWriter ? "Writer" : "Reader")
+                      << " already attached (pid " << prev << ")" << std::endl;
+            exit(1);
+        }
+    } while (!owner.compare_exchange_weak(prev, getpid()));
+    (bWriter ? hdr->writer_gen : hdr->reader_gen).fetch_add(1);
+}
+
+static void pshm_detach(pshm_queue *q, bool bWriter)
+{
+    (bWriter ? q->hdr->writer_pid : q->hdr->reader_pid).store(0);
+
+    if (munmap(q->hdr, q->map_size) == -1)
+        error("munmap");
+    close(q->fd);
+    q->hdr = NULL;
+}
+
+//
+// Block until cond() holds, sleeping on the futex word seq. Every WAIT_TIMEOUT_MS the
+// peer's owner pid is checked: a live peer is waited for indefinitely, a dead one is
+// reported and its role marked vacant. Returns false once the role has been vacant
+// for longer than q->timeout_ms.
+//
+template <typename Cond>
+static bool pshm_wait(pshm_queue *q, std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiting,
+                      std::atomic<pid_t> &peer, const char *peer_name, Cond cond)
+{
+    int vacant_ms = 0;
+    for (int spin = 0; spin < 1000; spin++)
+        if (cond())
+            return true;
+
+    for (;;) {
+        waiting.store(1);
+        uint32_t val = seq.load();
+        if (cond()) {
+            waiting.store(0);
+            return true;
+        }
+        if (futex_wait(&seq, val, WAIT_TIMEOUT_MS) == 0 || errno != ETIMEDOUT)
+            continue;
+
+        pid_t pid = peer.load();
+        if (pid != 0 && !pid_alive(pid)) {
+            std::cout << "[PSHM] " << peer_name << " (pid " << pid << ") died, waiting for it to restart" << std::endl;
+            peer.compare_exchange_strong(pid, 0);
+            pid = 0;
+        }
+        if (pid != 0)
+            vacant_ms = 0;
+        else if (q->timeout_ms >= 0 && (vacant_ms += WAIT_TIMEOUT_MS) >= q->timeout_ms) {
+            waiting.store(0);
+            return false;
+        }
+    }
+}
+
+static void pshm_commit(std::atomic<uint64_t> &cursor, uint64_t next,
+                        std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiting)
+{
+    cursor.store(next, std::memory_order_release);
+    seq.fetch_add(1);
+    if (waiting.load())
+        futex_wake(&seq);
+}
+
+static void add_latency(latency_stats *stats, high_resolution_clock::time_point from,
+                        high_resolution_clock::time_point to)
+{
+    double latency = (double)duration_cast<nanoseconds>(to - from).count() / 1000.0;
+    if (stats->n == 0 || latency < stats->min)
+        stats->min = latency;
+    if (stats->n == 0 || latency > stats->max)
+        stats->max = latency;
+    stats->sum += latency;
+    stats->n++;
+}
+
+//
+// attach: detach -> re-attached (segment mapped, role claimed, cursor loaded)
+// resume: detach -> first message committed after re-attach, i.e. including any wait for the peer
+//
+static void print_reconnect(const char *who, const latency_stats& attach, const latency_stats& resume)
+{
+    if (attach.n == 0)
+        return;
+    std::cout << "[PSHM " << who << " RECONNECT]\n"
+              << "Reconnects       : " << attach.n << "\n"
+              << "Avg attach       : " << attach.sum / attach.n << " usec\n"
+              << "Min attach       : " << attach.min << " usec\n"
+              << "Max attach       : " << attach.max << " usec\n";
+    if (resume.n > 0)
+        std::cout << "Avg resume       : " << resume.sum / resume.n << " usec\n"
+                  << "Min resume       : " << resume.min << " usec\n"
+                  << "Max resume       : " << resume.max << " usec\n";
+    std::cout << std::endl;
+}
+
+//
+// reconnect_every: detach and re-attach every N messages to measure reconnect latency
+// crash_after:     _exit() without detaching after N messages to simulate a crash
+// timeout_ms:      how long to wait while the peer's role is vacant, < 0 waits forever
+//
+int pshm_reader(int msz_size, int msz_num, bool bCheck, int reconnect_every, int crash_after, int timeout_ms)
+{
+    pshm_queue q;
+    char *mybuf;
+    uint64_t tail, start;
+    int i;
+
+    high_resolution_clock::time_point t1, t2, r1, r2;
+    double duration, total_size;
+    latency_stats lat_attach = {0, 0.0, 0.0, 0.0}, lat_resume = {0, 0.0, 0.0, 0.0};
+    bool bReconnecting = false;
+
+    q.timeout_ms = timeout_ms;
+    r1 = high_resolution_clock::now();
+    pshm_attach(&q, msz_size, false);
+    r2 = high_resolution_clock::now();
+
+    mybuf = new char[msz_size];
+    start = tail = q.hdr->tail.load(std::memory_order_acquire);
+    std::cout << "[PSHM] Start reading at " << tail << " (generation " << q.hdr->reader_gen.load()
+              << ", attach " << duration_cast<microseconds>(r2 - r1).count() << " usec)" << std::endl;
+
+    // restarted at first message below; set here too so that a run that receives
+    // nothing (vacant writer, stream already complete) still reports a valid time
+    i = 0;
+    t1 = high_resolution_clock::now();
+    while (tail < (uint64_t)msz_num) {
+        pshm_header *hdr = q.hdr;
+        if (!pshm_wait(&q, hdr->head_seq, hdr->reader_waiting, hdr->writer_pid, "Writer",
+                       [hdr, tail] { return hdr->head.load(std::memory_order_acquire) > tail; })) {
+            std::cout << "[PSHM] No writer for " << timeout_ms << " ms, stop reading at " << tail << std::endl;
+            break;
+        }
+
+        // the slot may be reused by the writer as soon as tail is committed
+        pshm_slot *slot = get_slot(&q, tail);
+        uint64_t seq = slot->seq;
+        memcpy(mybuf, slot->data, msz_size);
+        if (seq != tail)
+            std::cout << "Out of order: " << seq << " vs. " << tail << std::endl;
+
+        if (i == 0)
+            t1 = high_resolution_clock::now();
+
+        tail++;
+        pshm_commit(hdr->tail, tail, hdr->tail_seq, hdr->writer_waiting);
+        if (bReconnecting) {
+            add_latency(&lat_resume, r1, high_resolution_clock::now());
+            bReconnecting = false;
+        }
+
+        if (bCheck)
+        {
+            for (int j = 0; j < msz_size; j++)
+                if (mybuf[j] != char((seq + j)%255))
+                {
+                    std::cout << "Incorrect data: " << mybuf[j] << " vs. " << char((seq + j)%255) << std::endl;
+                    break;
+                }
+        }
+        i++;
+
+        if (crash_after > 0 && i == crash_after) {
+            std::cout << "[PSHM] Reader crashing at " << tail << std::endl;
+            _exit(1);
+        }
+        if (reconnect_every > 0 && i % reconnect_every == 0 && tail < (uint64_t)msz_num) {
+            r1 = high_resolution_clock::now();
+            pshm_detach(&q, false);
+            pshm_attach(&q, msz_size, false);
+            tail = q.hdr->tail.load(std::memory_order_acquire);
+            add_latency(&lat_attach, r1, high_resolution_clock::now());
+            bReconnecting = true;
+        }
+    }
+    t2 = high_resolution_clock::now();
+    std::cout << "[PSHM] End reading: " << tail << std::endl;
+
+    bool bDone = tail == (uint64_t)msz_num;
+    pshm_detach(&q, false);
+    delete[] mybuf;
+
+    // the stream is complete only once the reader has committed the last message;
+    // anything short of that keeps the segment around for a restarted reader
+    if (bDone)
+        shm_unlink(SHARED_MEM_NAME);
+    else
+        std::cout << "Couldn't read all messages! Resume from " << tail << std::endl;
+
+    {
+        total_size = double(i) * double(msz_size) / 1024.0 / 1024.0; // MBytes
+        duration = (double)duration_cast<microseconds>(t2 - t1).count() / 1e6; //sec
+        std::cout << "[PSHM READER]\n"
+                  << "Start cursor     : " << start << "\n"
+                  << "Total # messages : " << i << "\n"
+                  << "Message size     : " << msz_size << " Bytes\n"
+                  << "Total size       : " << total_size << " MBytes\n"
+                  << "Total time       : " << duration << " seconds\n";
+        // nothing was transferred, e.g. the peer never showed up or the stream was already complete
+        if (i > 0)
+            std::cout << "Throughput       : " << total_size / duration << " MBytes/sec\n";
+        std::cout << std::endl;
+    }
+    print_reconnect("READER", lat_attach, lat_resume);
+
+    return 0;
+}
+
+int pshm_writer(int msz_size, int msz_num, int reconnect_every, int crash_after, int timeout_ms)
+{
+    pshm_queue q;
+    char *buf;
+    uint64_t head, start;
+    int i;
+
+    high_resolution_clock::time_point t1, t2, r1, r2;
+    double duration, total_size;
+    latency_stats lat_attach = {0, 0.0, 0.0, 0.0}, lat_resume = {0, 0.0, 0.0, 0.0};
+    bool bReconnecting = false;
+
+    q.timeout_ms = timeout_ms;
+    r1 = high_resolution_clock::now();
+    pshm_attach(&q, msz_size, true);
+    r2 = high_resolution_clock::now();
+
+    // the payload of message k is (k + j)%255, so a replayed or skipped message is detectable
+    buf = new char[msz_size + 255];
+    for (i = 0; i < msz_size + 255; i++)
+        buf[i] = (char)(i%255);
+
+    start = head = q.hdr->head.load(std::memory_order_acquire);
+    std::cout << "[PSHM] Start writing at " << head << ": " << msz_size << ", " << msz_num
+              << " (generation " << q.hdr->writer_gen.load()
+              << ", attach " << duration_cast<microseconds>(r2 - r1).count() << " usec)" << std::endl;
+
+    i = 0;
+    t1 = high_resolution_clock::now();
+    while (head < (uint64_t)msz_num) {
+        pshm_header *hdr = q.hdr;
+        if (!pshm_wait(&q, hdr->tail_seq, hdr->writer_waiting, hdr->reader_pid, "Reader",
+                       [hdr, head] { return head - hdr->tail.load(std::memory_order_acquire) < hdr->n_slots; })) {
+            std::cout << "[PSHM] No reader for " << timeout_ms << " ms, stop writing at " << head << std::endl;
+            break;
+        }
+
+        pshm_slot *slot = get_slot(&q, head);
+        memcpy(slot->data, buf + head%255, msz_size);
+        slot->seq = head;
+        slot->size = msz_size;
+
+        head++;
+        pshm_commit(hdr->head, head, hdr->head_seq, hdr->reader_waiting);
+        if (bReconnecting) {
+            add_latency(&lat_resume, r1, high_resolution_clock::now());
+            bReconnecting = false;
+        }
+        i++;
+
+        if (crash_after > 0 && i == crash_after) {
+            std::cout << "[PSHM] Writer crashing at " << head << std::endl;
+            _exit(1);
+        }
+        if (reconnect_every > 0 && i % reconnect_every == 0 && head < (uint64_t)msz_num) {
+            r1 = high_resolution_clock::now();
+            pshm_detach(&q, true);
+            pshm_attach(&q, msz_size, true);
+            head = q.hdr->head.load(std::memory_order_acquire);
+            add_latency(&lat_attach, r1, high_resolution_clock::now());
+            bReconnecting = true;
+        }
+    }
+    t2 = high_resolution_clock::now();
+    std::cout << "[PSHM] End writing: " << head << std::endl;
+
+    pshm_detach(&q, true);
+    delete[] buf;
+
+    if (head != (uint64_t)msz_num)
+        std::cout << "Couldn't write all messages! Resume from " << head << std::endl;
+    {
+        total_size = double(i) * double(msz_size) / 1024.0 / 1024.0; // MBytes
+        duration = (double)duration_cast<microseconds>(t2 - t1).count() / 1e6; // sec
+        std::cout << "[PSHM WRITER]\n"
+                  << "Start cursor     : " << start << "\n"
+                  << "Total # messages : " << i << "\n"
+                  << "Message size     : " << msz_size << " Bytes\n"
+                  << "Total size       : " << total_size << " MBytes\n"
+                  << "Total time       : " << duration << " seconds\n";
+        // nothing was transferred, e.g. the peer never showed up or the stream was already complete
+        if (i > 0)
+            std::cout << "Throughput       : " << total_size / duration << " MBytes/sec\n";
+        std::cout << std::endl;
+    }
+    print_reconnect("WRITER", lat_attach, lat_resume);
+
+    return 0;
+}
+
+int main (int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    int wrank, wsize;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &wsize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+
+    // role 2 removes a segment left behind by an aborted run
+    int role = atoi(argv[1]);
+    if (role == 2) {
+        shm_unlink(SHARED_MEM_NAME);
+        MPI_Finalize();
+        return 0;
+    }
+
+    int msz_size = atoi(argv[2]);
+    int msz_count = atoi(argv[3]);
+    int check = atoi(argv[4]);
+    int reconnect_every = argc > 5 ? atoi(argv[5]) : 0;
+    int crash_after = argc > 6 ? atoi(argv[6]) : 0;
+    int timeout_ms = argc > 7 ? atoi(argv[7]) : VACANT_TIMEOUT_MS;
+
+    if (role == 0)
+        pshm_reader(msz_size, msz_count, check==1, reconnect_every, crash_after, timeout_ms);
+    else
+        pshm_writer(msz_size, msz_count, reconnect_every, crash_after, timeout_ms);
+
+    MPI_Finalize();
+    return 0;
+}
+
+void error (std::string msg)
+{
+    perror(msg.c_str());
+    exit(1);
+}
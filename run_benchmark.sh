@@ -4,6 +4,11 @@ MSZ_COUNT=500000
 READER=0
 WRITER=1
 CHECK=0
+# adios payload compression: CODEC = none | lz4 | zstd | blosc | bzip2 (blosc/bzip2 are ADIOS2 operators)
+# PAYLOAD = 0 (j%255 pattern) | 1 (float field) | 2 (text records) | 3 (random)
+CODEC=none
+LEVEL=1
+PAYLOAD=1
 
 #echo "====== BEGIN FIFO ======"
 #rm -f myfifo
@@ -22,10 +27,29 @@ CHECK=0
 #wait $pid_r
 #echo "====== END SHARED ======"
 
+# persistent queue: either side may start first; RECONNECT_EVERY > 0 re-attaches every N
+# messages, CRASH_AFTER > 0 kills the reader after N messages and restarts it to resume,
+# VACANT_TIMEOUT is how long (ms) to wait for a missing peer, -1 waits forever
+#RECONNECT_EVERY=0
+#CRASH_AFTER=0
+#VACANT_TIMEOUT=30000
+#echo "====== BEGIN PERSISTENT SHARED ======"
+#./pshm 2
+#mpirun --allow-run-as-root -n 1 ./pshm $READER $MSZ_SIZE $MSZ_COUNT $CHECK $RECONNECT_EVERY $CRASH_AFTER $VACANT_TIMEOUT &
+#pid_r=$!
+#mpirun --allow-run-as-root -n 1 ./pshm $WRITER $MSZ_SIZE $MSZ_COUNT $CHECK $RECONNECT_EVERY 0 $VACANT_TIMEOUT &
+#pid_w=$!
+#wait $pid_r
+#if [ $CRASH_AFTER -gt 0 ]; then
+#    mpirun --allow-run-as-root -n 1 ./pshm $READER $MSZ_SIZE $MSZ_COUNT $CHECK $RECONNECT_EVERY 0 $VACANT_TIMEOUT
+#fi
+#wait $pid_w
+#echo "====== END PERSISTENT SHARED ======"
+
 echo "====== BEGIN ADIOS ======"
 rm -rf *.bp*
-mpirun --allow-run-as-root -n 1 ./adios $READER $MSZ_SIZE $MSZ_COUNT $CHECK &
+mpirun --allow-run-as-root -n 1 ./adios $READER $MSZ_SIZE $MSZ_COUNT $CHECK $CODEC $LEVEL $PAYLOAD &
 pid_r=$!
-mpirun --allow-run-as-root -n 1 ./adios $WRITER $MSZ_SIZE $MSZ_COUNT $CHECK
+mpirun --allow-run-as-root -n 1 ./adios $WRITER $MSZ_SIZE $MSZ_COUNT $CHECK $CODEC $LEVEL $PAYLOAD
 wait $pid_r
 echo "====== END ADIOS ======"